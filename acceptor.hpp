@@ -9,11 +9,12 @@
 #pragma once
 
 #include <iostream>
-#include <fstream>
 #include <string>
 
+#include "acceptor_state.hpp"
 #include "player.hpp"
 #include "protocol.hpp"
+#include "serializer.hpp"
 
 using namespace std;
 
@@ -25,64 +26,76 @@ namespace paxos {
 template <typename ProposalT=string, typename MsgT=typename protocol<ProposalT>::message_type>
 class acceptor : virtual public player<MsgT> {
  public:
-	acceptor(int id, int port, const vector<pair<string, string> > &peers) : player<MsgT>(id, port, peers) {
-		// read state
-		ifstream ifs(get_state_file_name());
-		if (!ifs) {
-			// no state file, create one
-			ofstream ofs(get_state_file_name());
-			ofs << -1 << endl
-				<< -1 << endl
-				<< ProposalT() << endl;
-			ofs.close();
-			// initialize state
-			highest_prepare_request_number_responded_ = -1;
-			highest_accepted_proposal_.first = -1;
-			highest_accepted_proposal_.second = ProposalT();
-		}
-		else {
-			ifs >> highest_prepare_request_number_responded_ >> highest_accepted_proposal_.first >> highest_accepted_proposal_.second;
-			ifs.close();
+	acceptor(int id, int port, const vector<pair<string, string> > &peers) :
+		player<MsgT>(id, port, peers), state_version_(0), saved_version_(0), state_(get_state_file_name()) {
+		// initialize state from the state file
+		highest_prepare_request_number_responded_ = state_.get_promised_n();
+		highest_accepted_proposal_.first = state_.get_accepted_n();
+		highest_accepted_proposal_.second = ProposalT();
+		if (highest_accepted_proposal_.first != -1) {
+			string encoded = state_.get_accepted_proposal();
+			const char *begin = encoded.data();
+			if (!serializer<ProposalT>::read(begin, begin + encoded.size(), highest_accepted_proposal_.second)) {
+				throw boost::system::system_error(EINVAL, boost::system::system_category(),
+						"acceptor: unreadable accepted proposal in state file " + get_state_file_name());
+			}
 		}
+		saved_accepted_n_ = highest_accepted_proposal_.first;
 	}
-	virtual ~acceptor() {
-		save_state();
-	}
+	virtual ~acceptor() { }
  protected:
 	virtual void handle_request(const string &raw_message, boost::shared_ptr<udp::endpoint> remote_endpoint) {
 		MsgT message = MsgT(protocol<ProposalT>::get_message_from_string(raw_message));
 		if (protocol<ProposalT>::is_prepare_request(message)) {
 			cout << player<MsgT>::get_name() << " receives prepare_request: " << message << endl;
-			if (!(highest_prepare_request_number_responded_ > message.get_n()) &&
-				!(highest_accepted_proposal_.first == message.get_n())) {
-				// return prepare_response
+			// update state
+			update_mutex_.lock();
+			bool promised = !(highest_prepare_request_number_responded_ > message.get_n()) &&
+							!(highest_accepted_proposal_.first == message.get_n());
+			pair<int, ProposalT> previous;
+			unsigned long version = 0;
+			if (promised) {
+				highest_prepare_request_number_responded_ = message.get_n();
+				previous = highest_accepted_proposal_;
+				version = ++state_version_;
+			}
+			update_mutex_.unlock();
+			if (promised) {
+				// save state, then return prepare_response
+				save_state(version);
 				typename protocol<ProposalT>::message_type prepare_response =
-						protocol<ProposalT>::get_prepare_response(message.get_n(), highest_accepted_proposal_.first, highest_accepted_proposal_.second);
-				send_message_back(prepare_response, remote_endpoint);
+						protocol<ProposalT>::get_prepare_response(message.get_n(), previous.first, previous.second);
+				player<MsgT>::send_message_back(prepare_response, remote_endpoint);
 				cout << player<MsgT>::get_name() << " sends prepare_response back: " << prepare_response << endl;
-				// update and save state
-				update_mutex_.lock();
-				highest_prepare_request_number_responded_ = message.get_n();
-				save_state();
-				update_mutex_.unlock();
 			}
 		}
 		else if (protocol<ProposalT>::is_accept_request(message)) {
 			cout << player<MsgT>::get_name() << " receives accept_request: " << message << endl;
-			if (!(highest_prepare_request_number_responded_ > message.get_n())) {
-				// return accept_response
+			// a proposal that cannot be saved is never accepted
+			string encoded;
+			serializer<ProposalT>::write(encoded, message.get_proposal());
+			if (encoded.size() > protocol<ProposalT>::max_proposal_size) {
+				cerr << player<MsgT>::get_name() << " rejects accept_request with a proposal of " << encoded.size() << " bytes" << endl;
+				return;
+			}
+			// update state
+			update_mutex_.lock();
+			bool accepted = !(highest_prepare_request_number_responded_ > message.get_n());
+			if (accepted && message.get_n() > highest_accepted_proposal_.first) {
+				highest_accepted_proposal_.first = message.get_n();
+				highest_accepted_proposal_.second = message.get_proposal();
+				++state_version_;
+			}
+			// for a duplicate n, the save of the first one may still be in progress
+			unsigned long version = state_version_;
+			update_mutex_.unlock();
+			if (accepted) {
+				// save state, then return accept_response
+				save_state(version, message.get_n(), encoded);
 				typename protocol<ProposalT>::message_type accept_response =
 						protocol<ProposalT>::get_accept_response(message.get_n(), message.get_proposal());
-				send_message_to_all(accept_response);
+				player<MsgT>::send_message_to_all(accept_response);
 				cout << player<MsgT>::get_name() << " sends accept_response to all: " << accept_response << endl;
-				// update and save state
-				update_mutex_.lock();
-				if (message.get_n() > highest_accepted_proposal_.first) {
-					highest_accepted_proposal_.first = message.get_n();
-					highest_accepted_proposal_.second = message.get_proposal();
-				}
-				save_state();
-				update_mutex_.unlock();
 			}
 		}
 		else {
@@ -92,18 +105,41 @@ class acceptor : virtual public player<MsgT> {
 	}
 	virtual string get_player_type() const { return "acceptor"; }
  private:
-	const char *get_state_file_name() const { return (player<MsgT>::get_id_string() + "_state.txt").c_str(); }
-	void save_state() const {
-		// write state to file
-		ofstream ofs(get_state_file_name());
-		ofs << highest_prepare_request_number_responded_ << endl
-			<< highest_accepted_proposal_.first << endl
-			<< highest_accepted_proposal_.second << endl;
-		ofs.close();
+	string get_state_file_name() const { return player<MsgT>::get_id_string() + "_state.bin"; }
+	// write the latest state in place, unless a save of a later version already covered this one;
+	// encoded is the serialized proposal numbered accepted_n, if the caller has it at hand
+	void save_state(unsigned long version, int accepted_n = -1, const string &encoded = string()) {
+		boost::mutex::scoped_lock lock(save_mutex_);
+		if (saved_version_ < version) {
+			update_mutex_.lock();
+			unsigned long latest_version = state_version_;
+			int promised_n = highest_prepare_request_number_responded_;
+			pair<int, ProposalT> accepted = highest_accepted_proposal_;
+			update_mutex_.unlock();
+			if (accepted.first == saved_accepted_n_) {
+				state_.save_promise(promised_n);
+			}
+			else if (accepted.first == accepted_n) {
+				state_.save_accepted(promised_n, accepted.first, encoded);
+				saved_accepted_n_ = accepted.first;
+			}
+			else {
+				string latest_encoded;
+				serializer<ProposalT>::write(latest_encoded, accepted.second);
+				state_.save_accepted(promised_n, accepted.first, latest_encoded);
+				saved_accepted_n_ = accepted.first;
+			}
+			saved_version_ = latest_version;
+		}
 	}
-	boost::mutex update_mutex_;
+	boost::mutex update_mutex_; // guards the in-memory state
 	int highest_prepare_request_number_responded_;
 	pair<int, ProposalT> highest_accepted_proposal_;
+	unsigned long state_version_; // bumped by every update of the in-memory state
+	boost::mutex save_mutex_; // guards the state file and the fields below
+	unsigned long saved_version_;
+	int saved_accepted_n_;
+	acceptor_state state_;
 };
 
 
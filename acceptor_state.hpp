@@ -0,0 +1,186 @@
+/*
+ * acceptor_state.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *       Email: agent@local
+ */
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <boost/cstdint.hpp>
+#include <boost/system/system_error.hpp>
+
+#include "protocol.hpp"
+
+using namespace std;
+
+namespace paxos {
+
+/**
+ * Persistent state of an acceptor, kept in a memory-mapped binary file of fixed layout.
+ * The file holds two checksummed records; every update is written into the older one and
+ * synced before it becomes current, so a torn write never destroys the last good state.
+ */
+class acceptor_state {
+ public:
+	explicit acceptor_state(const string &file_name) : fd_(-1), layout_(0), current_(0) {
+		// the destructor does not run if the constructor throws
+		try {
+			open_file(file_name);
+		}
+		catch (...) {
+			release();
+			throw;
+		}
+	}
+	~acceptor_state() { release(); }
+
+	int get_promised_n() const { return current_->promised_n; }
+	int get_accepted_n() const { return current_->accepted_n; }
+	string get_accepted_proposal() const { return string(current_->proposal, current_->proposal_size); }
+
+	// persist a new promise, keeping the accepted proposal
+	void save_promise(int promised_n) {
+		record &next = get_next_record();
+		next.promised_n = promised_n;
+		next.accepted_n = current_->accepted_n;
+		next.proposal_size = current_->proposal_size;
+		memcpy(next.proposal, current_->proposal, current_->proposal_size);
+		commit(next);
+	}
+	// persist a newly accepted proposal (already encoded) along with the promise
+	void save_accepted(int promised_n, int accepted_n, const string &proposal) {
+		if (proposal.size() > protocol<>::max_proposal_size) {
+			throw boost::system::system_error(EMSGSIZE, boost::system::system_category(), "acceptor_state::save_accepted()");
+		}
+		record &next = get_next_record();
+		next.promised_n = promised_n;
+		next.accepted_n = accepted_n;
+		next.proposal_size = proposal.size();
+		memcpy(next.proposal, proposal.data(), proposal.size());
+		commit(next);
+	}
+ private:
+	static const boost::uint32_t magic = 0x50585341; // "PXSA"
+	static const boost::uint32_t version = 2; // 2: the proposal is stored in its serialized form
+
+	struct record {
+		boost::uint32_t sequence;
+		boost::int32_t promised_n;
+		boost::int32_t accepted_n;
+		boost::uint32_t proposal_size;
+		boost::uint32_t checksum;
+		char proposal[protocol<>::max_proposal_size];
+	};
+	struct layout {
+		boost::uint32_t magic;
+		boost::uint32_t version;
+		record records[2];
+	};
+
+	void open_file(const string &file_name) {
+		fd_ = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd_ == -1) fail("open " + file_name);
+		struct stat st;
+		if (::fstat(fd_, &st) == -1) fail("fstat " + file_name);
+		bool fresh = st.st_size == 0;
+		if (fresh && ::ftruncate(fd_, sizeof(layout)) == -1) fail("ftruncate " + file_name);
+		if (!fresh && st.st_size != static_cast<off_t>(sizeof(layout))) fail_format(file_name, "unexpected size");
+		void *addr = ::mmap(0, sizeof(layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+		if (addr == MAP_FAILED) fail("mmap " + file_name);
+		layout_ = static_cast<layout *>(addr);
+
+		if (fresh || layout_->magic == 0) {
+			// no state yet, create one
+			memset(layout_, 0, sizeof(layout));
+			layout_->magic = magic;
+			layout_->version = version;
+			record &r = layout_->records[0];
+			r.sequence = 1;
+			r.promised_n = -1;
+			r.accepted_n = -1;
+			r.proposal_size = 0;
+			r.checksum = get_checksum(r);
+			sync(layout_, sizeof(layout));
+			current_ = &r;
+		}
+		else {
+			if (layout_->magic != magic) fail_format(file_name, "not an acceptor state file");
+			if (layout_->version != version) {
+				ostringstream oss;
+				oss << "version " << layout_->version << ", expected " << version;
+				fail_format(file_name, oss.str());
+			}
+			// the valid record with the higher sequence number is the current one
+			for (size_t i = 0; i != 2; ++i) {
+				record &r = layout_->records[i];
+				if (is_valid(r) && (current_ == 0 || r.sequence > current_->sequence)) current_ = &r;
+			}
+			if (current_ == 0) fail_format(file_name, "no valid record");
+		}
+	}
+	void release() {
+		if (layout_) ::munmap(layout_, sizeof(layout));
+		if (fd_ != -1) ::close(fd_);
+		layout_ = 0;
+		fd_ = -1;
+	}
+	record &get_next_record() { return current_ == &layout_->records[0] ? layout_->records[1] : layout_->records[0]; }
+	void commit(record &next) {
+		next.sequence = current_->sequence + 1;
+		next.checksum = get_checksum(next);
+		sync(&next, sizeof(record));
+		current_ = &next;
+	}
+	void sync(void *addr, size_t len) {
+		// msync requires a page-aligned address
+		static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+		size_t offset = reinterpret_cast<size_t>(addr) % page_size;
+		if (::msync(static_cast<char *>(addr) - offset, len + offset, MS_SYNC) == -1) fail("msync");
+	}
+
+	static bool is_valid(const record &r) {
+		return r.sequence != 0 && r.proposal_size <= protocol<>::max_proposal_size && r.checksum == get_checksum(r);
+	}
+	// FNV-1a over the header fields and the used part of the proposal
+	static boost::uint32_t get_checksum(const record &r) {
+		boost::uint32_t h = 2166136261u;
+		h = hash(h, &r.sequence, offsetof(record, checksum));
+		return hash(h, r.proposal, r.proposal_size);
+	}
+	static boost::uint32_t hash(boost::uint32_t h, const void *data, size_t len) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i != len; ++i) {
+			h ^= p[i];
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	static void fail(const string &what) {
+		throw boost::system::system_error(errno, boost::system::system_category(), "acceptor_state: " + what);
+	}
+	static void fail_format(const string &file_name, const string &what) {
+		throw boost::system::system_error(EINVAL, boost::system::system_category(), "acceptor_state: unusable state file " + file_name + " (" + what + ")");
+	}
+
+	acceptor_state(const acceptor_state &);
+	acceptor_state &operator=(const acceptor_state &);
+
+	int fd_;
+	layout *layout_;
+	record *current_;
+};
+
+
+} // namespace paxos
@@ -0,0 +1,161 @@
+/*
+ * apply_pipeline.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *       Email: agent@local
+ */
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <string>
+#include <set>
+#include <map>
+#include <deque>
+
+using namespace std;
+
+namespace paxos {
+
+/**
+ * Key_set declares the keys a proposal reads or writes, so that proposals with disjoint keys may be
+ * executed in parallel. An empty key set conflicts with every other proposal, which is the default.
+ * Specialize it for proposal types whose keys are known.
+ */
+template <typename ProposalT>
+struct key_set {
+	static void get_keys(const ProposalT &proposal, set<string> &keys) { }
+};
+
+/**
+ * Apply_pipeline executes chosen proposals on a pool of threads.
+ * Proposals are pushed in log order by a single producer. A dispatcher thread starts each proposal as soon
+ * as no running proposal shares a key with it, so conflicting proposals still execute in log order.
+ * Proposals are started strictly in log order: one that waits for a conflicting running proposal also holds
+ * back the later ones, even those with disjoint keys. This keeps the dispatcher free of per-key dependency
+ * tracking, at the cost of head-of-line blocking when conflicts are frequent.
+ * At most max_pending proposals wait to be started; push blocks beyond that, which slows the producer down.
+ * Completion is reported in log order, whatever order the executions finish in.
+ */
+template <typename ProposalT>
+class apply_pipeline {
+ public:
+	typedef boost::function<void (int, const ProposalT &)> callback_type;
+
+	apply_pipeline(callback_type execute, callback_type complete, size_t thread_counter = boost::thread::hardware_concurrency()) :
+		execute_(execute), complete_(complete), work_(new boost::asio::io_service::work(pool_)),
+		stopped_(false), next_sequence_(0), running_counter_(0), barrier_running_(false), next_complete_sequence_(0) {
+		for (size_t i = 0; i < max(thread_counter, size_t(1)); ++i) {
+			workers_.create_thread(boost::bind(&boost::asio::io_service::run, &pool_));
+		}
+		dispatcher_ = boost::thread(boost::bind(&apply_pipeline::dispatch, this));
+	}
+	~apply_pipeline() { stop(); }
+
+	// finish the proposals pushed so far and stop the threads; later pushes are dropped
+	void stop() {
+		mutex_.lock();
+		bool was_stopped = stopped_;
+		stopped_ = true;
+		mutex_.unlock();
+		if (was_stopped) return;
+		cond_.notify_all();
+		dispatcher_.join();
+		work_.reset();
+		workers_.join_all();
+	}
+
+	void push(int n, const ProposalT &proposal) {
+		entry e;
+		e.n = n;
+		e.proposal = proposal;
+		key_set<ProposalT>::get_keys(proposal, e.keys);
+		boost::mutex::scoped_lock lock(mutex_);
+		while (!stopped_ && pending_.size() >= max_pending) cond_.wait(lock);
+		if (stopped_) return;
+		e.sequence = next_sequence_++;
+		pending_.push_back(e);
+		lock.unlock();
+		cond_.notify_all();
+	}
+ private:
+	static const size_t max_pending = 1 << 12;
+	struct entry {
+		size_t sequence; // position in the log
+		int n;
+		ProposalT proposal;
+		set<string> keys;
+	};
+
+	void dispatch() {
+		boost::mutex::scoped_lock lock(mutex_);
+		while (true) {
+			while (!stopped_ && pending_.empty()) cond_.wait(lock);
+			if (pending_.empty()) break;
+			while (!can_start(pending_.front())) cond_.wait(lock);
+			entry e = pending_.front();
+			pending_.pop_front();
+			// wake a producer waiting for room
+			cond_.notify_all();
+			// mark the keys as busy
+			++running_counter_;
+			if (e.keys.empty()) barrier_running_ = true;
+			busy_keys_.insert(e.keys.begin(), e.keys.end());
+			pool_.post(boost::bind(&apply_pipeline::execute, this, e));
+		}
+		// wait for the running proposals
+		while (running_counter_ != 0) cond_.wait(lock);
+	}
+	bool can_start(const entry &e) const {
+		if (e.keys.empty()) return running_counter_ == 0;
+		if (barrier_running_) return false;
+		for (set<string>::const_iterator it = e.keys.begin(); it != e.keys.end(); ++it) {
+			if (busy_keys_.find(*it) != busy_keys_.end()) return false;
+		}
+		return true;
+	}
+	void execute(const entry &e) {
+		execute_(e.n, e.proposal);
+		mutex_.lock();
+		--running_counter_;
+		if (e.keys.empty()) barrier_running_ = false;
+		for (set<string>::const_iterator it = e.keys.begin(); it != e.keys.end(); ++it) busy_keys_.erase(*it);
+		mutex_.unlock();
+		cond_.notify_all();
+		// report completion in log order
+		complete_mutex_.lock();
+		executed_[e.sequence] = e;
+		while (!executed_.empty() && executed_.begin()->first == next_complete_sequence_) {
+			complete_(executed_.begin()->second.n, executed_.begin()->second.proposal);
+			executed_.erase(executed_.begin());
+			++next_complete_sequence_;
+		}
+		complete_mutex_.unlock();
+	}
+
+	callback_type execute_;
+	callback_type complete_;
+	boost::asio::io_service pool_;
+	boost::scoped_ptr<boost::asio::io_service::work> work_;
+	boost::thread_group workers_;
+	boost::thread dispatcher_;
+	boost::mutex mutex_; // guards the fields below
+	boost::condition_variable cond_;
+	bool stopped_;
+	size_t next_sequence_;
+	deque<entry> pending_;
+	size_t running_counter_;
+	bool barrier_running_; // a proposal without keys is running
+	set<string> busy_keys_;
+	boost::mutex complete_mutex_; // guards the fields below
+	map<size_t, entry> executed_;
+	size_t next_complete_sequence_;
+};
+
+
+} // namespace paxos
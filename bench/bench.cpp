@@ -0,0 +1,223 @@
+/*
+ * bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *       Email: agent@local
+ */
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "paxos_player.hpp"
+#include "acceptor_state.hpp"
+#include "protocol.hpp"
+
+using namespace std;
+using namespace boost::asio::ip;
+
+// count the allocations of each thread, so that the benchmark thread does not see those of background threads
+// (the flusher of player::run is not started, but the apply pipeline of a learner is)
+static __thread size_t allocation_counter = 0;
+static __thread size_t allocated_bytes = 0;
+
+void *operator new(size_t size) {
+	++allocation_counter;
+	allocated_bytes += size;
+	void *p = malloc(size ? size : 1);
+	if (!p) throw bad_alloc();
+	return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) throw() { free(p); }
+void operator delete[](void *p) throw() { free(p); }
+void operator delete(void *p, size_t) throw() { free(p); }
+void operator delete[](void *p, size_t) throw() { free(p); }
+
+typedef paxos::protocol<> protocol_type;
+typedef protocol_type::message_type message_type;
+typedef vector<pair<string, string> > peers_type;
+
+/**
+ * Exposes handle_request of a role, so that messages can be fed to it without the network
+ */
+template <typename RoleT>
+class bench_player : public RoleT {
+ public:
+	bench_player(int id, const peers_type &peers) : paxos::player<message_type>(id, 0, peers), RoleT(id, 0, peers) { }
+	using RoleT::handle_request;
+};
+
+static ostream *report = &cerr;
+
+// run op for at least min_time, doubling the number of iterations, and report the cost of one op
+void run(const string &name, boost::function<void ()> op) {
+	static const double min_time = 0.2; // seconds
+	op(); // warm up
+	size_t iterations = 1;
+	while (true) {
+		size_t allocations = allocation_counter, bytes = allocated_bytes;
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		for (size_t i = 0; i != iterations; ++i) op();
+		double elapsed = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+		if (elapsed >= min_time) {
+			*report << left << setw(64) << name << right << fixed
+				 << setw(12) << setprecision(1) << elapsed * 1e9 / iterations << " ns/op"
+				 << setw(10) << setprecision(2) << double(allocation_counter - allocations) / iterations << " allocs/op"
+				 << setw(10) << setprecision(1) << double(allocated_bytes - bytes) / iterations << " B/op" << endl;
+			return;
+		}
+		iterations *= 2;
+	}
+}
+
+// protocol
+void encode(const message_type &message) { string raw_message(message); }
+void decode(const string &raw_message) { message_type message = protocol_type::get_message_from_string(raw_message); }
+
+// role dispatch
+template <typename PlayerT>
+void handle(PlayerT *p, const string &raw_message, boost::shared_ptr<udp::endpoint> remote_endpoint) {
+	p->handle_request(raw_message, remote_endpoint);
+}
+
+// acceptor persistence: the former text file rewrite, then the memory-mapped state
+void save_text_state(const string &file_name, int promised_n, int accepted_n, const string &proposal, bool durable) {
+	ofstream ofs(file_name.c_str());
+	ofs << promised_n << endl
+		<< accepted_n << endl
+		<< proposal << endl;
+	ofs.close();
+	if (durable) {
+		// the former save_state never did this, so it could lose a promise on a crash
+		int fd = open(file_name.c_str(), O_RDONLY);
+		fsync(fd);
+		close(fd);
+	}
+}
+void save_promise(paxos::acceptor_state *state, int *n) { state->save_promise(++*n); }
+void save_accepted(paxos::acceptor_state *state, int *n, const string &proposal) { ++*n; state->save_accepted(*n, *n, proposal); }
+
+// acceptor: requests with increasing numbers, so that every one is accepted and saved (includes encoding the request)
+template <typename PlayerT>
+void acceptor_promise(PlayerT *p, int *n, boost::shared_ptr<udp::endpoint> remote_endpoint) {
+	p->handle_request(string(protocol_type::get_prepare_request(++*n)), remote_endpoint);
+}
+template <typename PlayerT>
+void acceptor_accept(PlayerT *p, int *n, boost::shared_ptr<udp::endpoint> remote_endpoint, const string &proposal) {
+	++*n;
+	p->handle_request(string(protocol_type::get_prepare_request(*n)), remote_endpoint);
+	p->handle_request(string(protocol_type::get_accept_request(*n, proposal)), remote_endpoint);
+}
+
+// proposer: client_request, then prepare_responses up to the majority
+template <typename PlayerT>
+void propose(PlayerT *p, int *n, boost::shared_ptr<udp::endpoint> remote_endpoint, const string &client_request, size_t majority) {
+	p->handle_request(client_request, remote_endpoint);
+	string prepare_response(protocol_type::get_prepare_response(*n, -1, string()));
+	for (size_t i = 0; i != majority; ++i) p->handle_request(prepare_response, remote_endpoint);
+	*n = protocol_type::get_number(1, *n);
+}
+
+// learner: a new accept_response each time
+template <typename PlayerT>
+void learn(PlayerT *p, int *n, boost::shared_ptr<udp::endpoint> remote_endpoint) {
+	p->handle_request(string(protocol_type::get_accept_response(++*n, "proposal")), remote_endpoint);
+}
+
+int main(int argc, char **argv)
+{
+	// the roles log every message, keep that out of the numbers
+	ofstream null_stream("/dev/null");
+	streambuf *cout_buf = cout.rdbuf(null_stream.rdbuf());
+	ostream report_stream(cout_buf);
+	report = &report_stream;
+	*report << "allocations are those of the benchmark thread only, work handed to other threads is not counted" << endl;
+
+	// peers that never answer; sends are queued and batched as usual
+	peers_type peers;
+	peers.push_back(make_pair("localhost", "9"));
+	peers.push_back(make_pair("localhost", "9"));
+	peers.push_back(make_pair("localhost", "9"));
+	peers.push_back(make_pair("localhost", "9"));
+	boost::shared_ptr<udp::endpoint> remote_endpoint(new udp::endpoint(address_v4::loopback(), 9));
+
+	const size_t payload_sizes[] = { 16, 256, 1000 };
+	for (size_t i = 0; i != sizeof(payload_sizes) / sizeof(payload_sizes[0]); ++i) {
+		ostringstream suffix;
+		suffix << " (" << payload_sizes[i] << " B proposal)";
+		message_type message = protocol_type::get_accept_request(42, string(payload_sizes[i], 'x'));
+		run("protocol encode accept_request" + suffix.str(), boost::bind(encode, message));
+		run("protocol decode accept_request" + suffix.str(), boost::bind(decode, string(message)));
+	}
+	run("protocol encode prepare_request", boost::bind(encode, protocol_type::get_prepare_request(42)));
+	run("protocol decode prepare_request", boost::bind(decode, string(protocol_type::get_prepare_request(42))));
+
+	{
+		bench_player<paxos::paxos_player<> > p(7, peers);
+		// a promise above every number used below, so that the acceptor only checks and rejects
+		p.handle_request(string(protocol_type::get_prepare_request(1 << 30)), remote_endpoint);
+		p.handle_request(string(protocol_type::get_accept_response(7, "proposal")), remote_endpoint);
+		run("paxos_player dispatch to learner (duplicate accept_response)",
+				boost::bind(handle<bench_player<paxos::paxos_player<> > >, &p, string(protocol_type::get_accept_response(7, "proposal")), remote_endpoint));
+		run("paxos_player dispatch to proposer (stale prepare_response)",
+				boost::bind(handle<bench_player<paxos::paxos_player<> > >, &p, string(protocol_type::get_prepare_response(7, -1, string())), remote_endpoint));
+		run("paxos_player dispatch to acceptor (rejected accept_request)",
+				boost::bind(handle<bench_player<paxos::paxos_player<> > >, &p, string(protocol_type::get_accept_request(7, "proposal")), remote_endpoint));
+	}
+	remove("7_state.bin");
+
+	{
+		string proposal(256, 'x');
+		run("acceptor text state rewrite (former save_state, no fsync)", boost::bind(save_text_state, "bench_state.txt", 1, 1, proposal, false));
+		run("acceptor text state rewrite + fsync", boost::bind(save_text_state, "bench_state.txt", 1, 1, proposal, true));
+		remove("bench_state.txt");
+		paxos::acceptor_state state("bench_state.bin");
+		int n = 0;
+		run("acceptor_state::save_promise (msync)", boost::bind(save_promise, &state, &n));
+		run("acceptor_state::save_accepted (msync, 256 B proposal)", boost::bind(save_accepted, &state, &n, proposal));
+	}
+	remove("bench_state.bin");
+
+	{
+		remove("8_state.bin");
+		bench_player<paxos::acceptor<> > p(8, peers);
+		int n = 0;
+		run("acceptor accepted prepare_request (handle_request, msync)", boost::bind(acceptor_promise<bench_player<paxos::acceptor<> > >, &p, &n, remote_endpoint));
+		run("acceptor accepted prepare_request + accept_request (256 B proposal)",
+				boost::bind(acceptor_accept<bench_player<paxos::acceptor<> > >, &p, &n, remote_endpoint, string(256, 'x')));
+	}
+	remove("8_state.bin");
+
+	{
+		bench_player<paxos::proposer<> > p(1, peers);
+		int n = protocol_type::get_number(1);
+		run("proposer round (client_request + majority of prepare_responses)",
+				boost::bind(propose<bench_player<paxos::proposer<> > >, &p, &n, remote_endpoint,
+						string(protocol_type::get_client_request("proposal")), peers.size() / 2));
+	}
+
+	{
+		bench_player<paxos::learner<> > p(1, peers);
+		int n = 0;
+		p.handle_request(string(protocol_type::get_accept_response(n, "proposal")), remote_endpoint);
+		run("learner duplicate accept_response",
+				boost::bind(handle<bench_player<paxos::learner<> > >, &p, string(protocol_type::get_accept_response(n, "proposal")), remote_endpoint));
+		run("learner new accept_response (dedup insert + apply pipeline)", boost::bind(learn<bench_player<paxos::learner<> > >, &p, &n, remote_endpoint));
+	}
+
+	cout.rdbuf(cout_buf);
+	return 0;
+}
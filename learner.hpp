@@ -11,7 +11,12 @@
 #include <iostream>
 #include <string>
 #include <set>
+#include <map>
+#include <boost/bind/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 
+#include "acceptor_state.hpp"
+#include "apply_pipeline.hpp"
 #include "player.hpp"
 #include "protocol.hpp"
 
@@ -25,33 +30,126 @@ namespace paxos {
 template <typename ProposalT=string, typename MsgT=typename protocol<ProposalT>::message_type>
 class learner : virtual public player<MsgT> {
  public:
-	learner(int id, int port, const vector<pair<string, string> > &peers) : player<MsgT>(id, port, peers) { }
-	virtual ~learner() { }
+	learner(int id, int port, const vector<pair<string, string> > &peers, bool multi_leader = false) :
+		player<MsgT>(id, port, peers), multi_leader_(multi_leader), leader_counter_(peers.size() + 1), last_executed_n_(-1),
+		saved_executed_n_(-1), saved_leader_counter_(0),
+		pipeline_(boost::bind(&learner::execute_proposal, this, boost::placeholders::_1, boost::placeholders::_2),
+				  boost::bind(&learner::proposal_executed, this, boost::placeholders::_1, boost::placeholders::_2)) {
+		if (multi_leader_) load_position();
+	}
+	virtual ~learner() { stop_applying(); }
  protected:
+	// the apply pipeline calls execute_proposal and proposal_executed from its own threads, so a subclass
+	// overriding either must call this in its destructor, before the overrides are destroyed
+	void stop_applying() { pipeline_.stop(); }
 	virtual void handle_request(const string &raw_message, boost::shared_ptr<udp::endpoint> remote_endpoint) {
 		MsgT message = MsgT(protocol<ProposalT>::get_message_from_string(raw_message));
 		if (protocol<ProposalT>::is_accept_response(message)) {
 			cout << player<MsgT>::get_name() << " receives accept_response: " << message << endl;
+			if (multi_leader_ && message.get_n() < 0) {
+				// no leader owns it
+				cerr << player<MsgT>::get_name() << " rejects accept_response: " << message << endl;
+				return;
+			}
 			lock_.lock();
-			if (proposal_done_.find(message.get_n()) == proposal_done_.end()) {
-				execute_proposal(message.get_n(), message.get_proposal());
+			if (multi_leader_) {
+				decide(message.get_n(), false, message.get_proposal());
+				execute_decided();
+			}
+			else if (proposal_done_.find(message.get_n()) == proposal_done_.end()) {
+				pipeline_.push(message.get_n(), message.get_proposal());
 				proposal_done_.insert(message.get_n());
 			}
 			lock_.unlock();
 		}
+		else if (multi_leader_ && protocol<ProposalT>::is_skip_request(message)) {
+			cout << player<MsgT>::get_name() << " receives skip_request: " << message << endl;
+			int owner = protocol<ProposalT>::get_owner(message.get_n());
+			// the range must be the owner's own numbers, or the loop below would not end
+			if (message.get_n() < 0 || owner < 0 || owner > 9 || message.get_next_n() < message.get_n() ||
+					protocol<ProposalT>::get_owner(message.get_next_n()) != owner) {
+				cerr << player<MsgT>::get_name() << " rejects skip_request: " << message << endl;
+				return;
+			}
+			lock_.lock();
+			// an empty range only announces the leader
+			leaders_.insert(owner);
+			for (int n = message.get_n(); n < message.get_next_n(); n = protocol<ProposalT>::get_number(owner, n)) {
+				decide(n, true, ProposalT());
+			}
+			execute_decided();
+			lock_.unlock();
+		}
 		else {
 			// not able to handle the request, pass the information to the higher level
 			throw true;
 		}
 	}
 	virtual string get_player_type() const { return "learner"; }
+	// runs on the apply pipeline, in parallel with the proposals whose key_set is disjoint from this one's
 	virtual void execute_proposal(int n, const ProposalT &proposal) const {
 		// default behavior, just output
 		cout << player<MsgT>::get_name() << " executes proposal[n=" << n << "]: " << proposal << endl;
 	}
+	// runs in log order once the proposal has been executed, e.g. to return the result to the client
+	virtual void proposal_executed(int n, const ProposalT &proposal) const { }
  private:
+	// multi-leader mode: proposals are executed in number order, skipped numbers leaving no gap
+	void decide(int n, bool skipped, const ProposalT &proposal) {
+		leaders_.insert(protocol<ProposalT>::get_owner(n));
+		if (n <= last_executed_n_ || decided_.find(n) != decided_.end()) return;
+		decided_[n] = make_pair(skipped, proposal);
+	}
+	void execute_decided() {
+		// the order is only known once every leader has been heard from
+		while (leaders_.size() >= leader_counter_) {
+			typename map<int, pair<bool, ProposalT> >::iterator it = decided_.find(get_next_number(last_executed_n_));
+			if (it == decided_.end()) break;
+			if (!it->second.first) pipeline_.push(it->first, it->second.second);
+			last_executed_n_ = it->first;
+			decided_.erase(it);
+		}
+		save_position();
+	}
+	// the position is kept in an acceptor_state: the last executed number as promised_n,
+	// and the leaders heard from as the proposal, one byte each
+	void load_position() {
+		position_.reset(new acceptor_state(player<MsgT>::get_id_string() + "_learner.bin"));
+		last_executed_n_ = position_->get_promised_n();
+		string leaders = position_->get_accepted_proposal();
+		leaders_.insert(leaders.begin(), leaders.end());
+		saved_executed_n_ = last_executed_n_;
+		saved_leader_counter_ = leaders_.size();
+	}
+	// a restarted learner resumes after the proposals it handed to the apply pipeline, even if they were not
+	// executed before the crash, and it does not learn what was decided while it was down
+	void save_position() {
+		if (last_executed_n_ == saved_executed_n_ && leaders_.size() == saved_leader_counter_) return;
+		position_->save_accepted(last_executed_n_, last_executed_n_, string(leaders_.begin(), leaders_.end()));
+		saved_executed_n_ = last_executed_n_;
+		saved_leader_counter_ = leaders_.size();
+	}
+	// the smallest number after n owned by any leader
+	int get_next_number(int n) const {
+		int result = -1;
+		for (set<int>::const_iterator it = leaders_.begin(); it != leaders_.end(); ++it) {
+			int m = n - protocol<ProposalT>::get_owner(n) + *it;
+			if (m <= n) m = protocol<ProposalT>::get_number(*it, m);
+			if (result == -1 || m < result) result = m;
+		}
+		return result;
+	}
 	set<int> proposal_done_; // record the proposals done
 	boost::mutex lock_;
+	bool multi_leader_;
+	size_t leader_counter_;
+	set<int> leaders_; // the leaders heard from
+	map<int, pair<bool, ProposalT> > decided_; // decided but not executed yet, with whether skipped
+	int last_executed_n_;
+	int saved_executed_n_; // the position in the state file, multi-leader mode only
+	size_t saved_leader_counter_;
+	boost::scoped_ptr<acceptor_state> position_;
+	apply_pipeline<ProposalT> pipeline_; // last member, so that it is stopped before the others are destroyed
 };
 
 
@@ -49,14 +49,15 @@ void setup_client(const string &hostname, const string &port) {
 int main(int argc, char **argv)
 {
 	if (argc < 2) {
-		cerr << "Usage: ./Paxos [proposer, acceptor, learner, or paxos_player] config_file_name | ./Paxos client hostname port" << endl;
+		cerr << "Usage: ./Paxos [proposer, acceptor, learner, paxos_player, or mencius_player] config_file_name | ./Paxos client hostname port" << endl;
 		return 0;
 	}
 	// parse command-line parameters
 	// node_type = "server" | "client"
 	string node_type(argv[1]);
 	// if node_type == "server"
-	if (node_type == "proposer" || node_type == "acceptor" || node_type == "learner" || node_type == "paxos_player") {
+	if (node_type == "proposer" || node_type == "acceptor" || node_type == "learner" || node_type == "paxos_player" ||
+		node_type == "mencius_player") {
 		string type(argv[1]);
 		string file_name(argv[2]);
 		ifstream ifs(file_name.c_str());
@@ -78,7 +79,7 @@ int main(int argc, char **argv)
 		boost::thread client_thread(boost::bind(setup_client, hostname, port));
 		client_thread.join();
 	} else {
-		cerr << "Usage: ./Paxos [proposer, acceptor, learner, or paxos_player] config_file_name | ./Paxos client hostname port" << endl;
+		cerr << "Usage: ./Paxos [proposer, acceptor, learner, paxos_player, or mencius_player] config_file_name | ./Paxos client hostname port" << endl;
 	}
 
 	return 0;
@@ -19,16 +19,17 @@ namespace paxos {
 
 /**
  * The combined role of Proposer, Acceptor, and Learner in Paxos algorithm
+ * In multi-leader (Mencius) mode, every player leads the numbers it owns, see protocol::get_number
  */
 template <typename ProposalT=string, typename MsgT=typename protocol<ProposalT>::message_type>
 class paxos_player : public proposer<ProposalT, MsgT>, public acceptor<ProposalT, MsgT>, public learner<ProposalT, MsgT> {
  public:
-	paxos_player(int id, int port, const vector<pair<string, string> > &peers) :
+	paxos_player(int id, int port, const vector<pair<string, string> > &peers, bool multi_leader = false) :
 		player<MsgT>(id, port, peers),
-		proposer<ProposalT, MsgT>(id, port, peers),
+		proposer<ProposalT, MsgT>(id, port, peers, multi_leader),
 		acceptor<ProposalT, MsgT>(id, port, peers),
-		learner<ProposalT, MsgT>(id, port, peers) { }
-	virtual ~paxos_player() { }
+		learner<ProposalT, MsgT>(id, port, peers, multi_leader) { }
+	virtual ~paxos_player() { learner<ProposalT, MsgT>::stop_applying(); }
  protected:
 	virtual void handle_request(const string &raw_message, boost::shared_ptr<udp::endpoint> remote_endpoint) {
 		// handle request by super classes
@@ -41,12 +42,12 @@ class paxos_player : public proposer<ProposalT, MsgT>, public acceptor<ProposalT
 				try {
 					acceptor<ProposalT, MsgT>::handle_request(raw_message, remote_endpoint);
 				} catch (...) {
-					cerr << player<MsgT>::get_name() << " cannot handle request(raw message): " << raw_message << endl;
+					cerr << player<MsgT>::get_name() << " cannot handle request: " << protocol<ProposalT>::get_message_from_string(raw_message) << endl;
 				}
 			}
 		}
 	}
-	virtual string get_player_type() const { return "paxos_player"; }
+	virtual string get_player_type() const { return proposer<ProposalT, MsgT>::is_multi_leader() ? "mencius_player" : "paxos_player"; }
 };
 
 
@@ -11,6 +11,7 @@
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 #include <string>
 #include <iostream>
 #include <vector>
@@ -42,42 +43,131 @@ class player {
 	int id_;
 	string get_id_string() const { ostringstream oss; oss << id_; return oss.str(); }
  private:
+	void handle_datagram(const string &datagram, boost::shared_ptr<udp::endpoint> remote_endpoint);
+	void queue_message(size_t i, const MsgT &message);
+	void flush_all();
+	void flush_expired();
 	boost::asio::io_service io_service_;
 	int port_;
 	udp::socket server_socket_;
 	vector<boost::shared_ptr<player_proxy<MsgT> > > peers_;
-	static const size_t buf_size = 1 << 10;
+	size_t handlers_in_flight_; // datagrams received but not handled yet
+	boost::mutex in_flight_mutex_;
+	boost::mutex flush_mutex_; // guards the field below
+	boost::condition_variable flush_cond_;
+	vector<boost::posix_time::ptime> deadlines_; // of the queue of each peer, not_a_date_time if none is pending
+	static const size_t buf_size = 1 << 16; // the largest UDP datagram
 };
 
 // implementation
+
 template <typename MsgT>
 player<MsgT>::player(int id, int port, const vector<pair<string, string> > &peers) :
-	id_(id), port_(port), server_socket_(io_service_, udp::endpoint(udp::v4(), port)) {
+	id_(id), port_(port), server_socket_(io_service_, udp::endpoint(udp::v4(), port)), handlers_in_flight_(0) {
 	// connecting the peers
 	for (size_t i = 0; i < peers.size(); ++i) {
 		const pair<string, string> &info = peers[i];
 		boost::shared_ptr<player_proxy<MsgT> > ptr(new player_proxy<MsgT>(info.first, info.second, io_service_));
 		peers_.push_back(ptr);
 	}
+	deadlines_.resize(peers_.size());
 }
 
 template <typename MsgT>
 void player<MsgT>::run() {
+	// flush the outgoing queues when their deadline expires
+	boost::thread flusher(boost::bind(&player::flush_expired, this));
 	// main server loop
 	try {
+		boost::array<char, buf_size> recv_buf;
 		while (true) {
-			boost::array<char, buf_size> recv_buf;
 			boost::shared_ptr<udp::endpoint> remote_endpoint(new udp::endpoint);
 			boost::system::error_code error;
 			size_t len = server_socket_.receive_from(boost::asio::buffer(recv_buf), *remote_endpoint, 0, error);
 			if (error && error != boost::asio::error::message_size)
 				throw boost::system::system_error(error);
 			// launch new thread to handle request
-			boost::thread(boost::bind(&player::handle_request, this, string(recv_buf.begin(), recv_buf.begin() + len), remote_endpoint));
+			in_flight_mutex_.lock();
+			++handlers_in_flight_;
+			in_flight_mutex_.unlock();
+			boost::thread(boost::bind(&player::handle_datagram, this, string(recv_buf.begin(), recv_buf.begin() + len), remote_endpoint));
 		}
 	} catch (exception &e) {
 		cerr << "Exception in player::run(): " << e.what() << endl;
 	}
+	flusher.interrupt();
+	flusher.join();
+}
+
+template <typename MsgT>
+void player<MsgT>::handle_datagram(const string &datagram, boost::shared_ptr<udp::endpoint> remote_endpoint) {
+	// a datagram may carry several messages
+	vector<string> messages = protocol<>::get_messages_from_batch(datagram);
+	for (size_t i = 0; i != messages.size(); ++i) {
+		try {
+			handle_request(messages[i], remote_endpoint);
+		} catch (...) {
+			cerr << get_name() << " cannot handle request of " << messages[i].size() << " bytes" << endl;
+		}
+	}
+	// flush the outgoing queues once there is nothing left to handle
+	in_flight_mutex_.lock();
+	bool idle = --handlers_in_flight_ == 0;
+	in_flight_mutex_.unlock();
+	if (idle) flush_all();
+}
+
+template <typename MsgT>
+void player<MsgT>::flush_all() {
+	for (size_t i = 0; i != peers_.size(); ++i) {
+		peers_[i]->flush(server_socket_);
+	}
+}
+
+template <typename MsgT>
+void player<MsgT>::flush_expired() {
+	try {
+		boost::mutex::scoped_lock lock(flush_mutex_);
+		while (true) {
+			// sleep until the earliest deadline, or until a queue is started if none is pending
+			size_t earliest = deadlines_.size();
+			for (size_t i = 0; i != deadlines_.size(); ++i) {
+				if (!deadlines_[i].is_not_a_date_time() && (earliest == deadlines_.size() || deadlines_[i] < deadlines_[earliest])) {
+					earliest = i;
+				}
+			}
+			if (earliest == deadlines_.size()) {
+				flush_cond_.wait(lock);
+				continue;
+			}
+			boost::posix_time::ptime deadline = deadlines_[earliest];
+			if (boost::posix_time::microsec_clock::universal_time() < deadline) {
+				flush_cond_.timed_wait(lock, deadline);
+				continue;
+			}
+			deadlines_[earliest] = boost::posix_time::ptime();
+			lock.unlock();
+			// the queue may have been sent and started again since, then wait for its new deadline
+			boost::posix_time::ptime next = peers_[earliest]->flush_expired(server_socket_, deadline);
+			lock.lock();
+			if (!next.is_not_a_date_time() && (deadlines_[earliest].is_not_a_date_time() || next < deadlines_[earliest])) {
+				deadlines_[earliest] = next;
+			}
+		}
+	} catch (boost::thread_interrupted &) {
+	}
+}
+
+template <typename MsgT>
+void player<MsgT>::queue_message(size_t i, const MsgT &message) {
+	boost::posix_time::ptime deadline = peers_[i]->send_message(server_socket_, message);
+	if (deadline.is_not_a_date_time()) return;
+	// a pending deadline is earlier, or stale and renewed by the flusher
+	flush_mutex_.lock();
+	bool arm = deadlines_[i].is_not_a_date_time();
+	if (arm) deadlines_[i] = deadline;
+	flush_mutex_.unlock();
+	if (arm) flush_cond_.notify_one();
 }
 
 template <typename MsgT>
@@ -90,12 +180,19 @@ string  player<MsgT>::get_name() const {
 template <typename MsgT>
 void player<MsgT>::send_message_to_all(const MsgT &message) {
 	for (size_t i = 0; i != peers_.size(); ++i) {
-		peers_[i]->send_message(server_socket_, message);
+		queue_message(i, message);
 	}
 }
 
 template <typename MsgT>
 void player<MsgT>::send_message_back(const MsgT &message, boost::shared_ptr<udp::endpoint> remote_endpoint) {
+	// queue the message if it goes to a peer, send it directly otherwise (e.g. to a client)
+	for (size_t i = 0; i != peers_.size(); ++i) {
+		if (peers_[i]->get_endpoint() == *remote_endpoint) {
+			queue_message(i, message);
+			return;
+		}
+	}
 	server_socket_.send_to(boost::asio::buffer(string(message)), *remote_endpoint);
 }
 
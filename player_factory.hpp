@@ -29,6 +29,7 @@ class player_factory {
 	static boost::shared_ptr<player<MsgT> > get_player(const string &type, int id, int mainport, const vector<pair<string, string> > &peers) {
 		player<MsgT> *p;
 		if (type == "paxos_player") p = new paxos_player<ProposalT, MsgT>(id, mainport, peers);
+		else if (type == "mencius_player") p = new paxos_player<ProposalT, MsgT>(id, mainport, peers, true);
 		else if (type == "proposer") p = new proposer<ProposalT, MsgT>(id, mainport, peers);
 		else if (type == "acceptor") p = new acceptor<ProposalT, MsgT>(id, mainport, peers);
 		else if (type == "learner") p = new learner<ProposalT, MsgT>(id, mainport, peers);
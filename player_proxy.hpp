@@ -9,6 +9,11 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+
+#include "protocol.hpp"
 
 using namespace std;
 using namespace boost::asio::ip;
@@ -33,16 +38,57 @@ class player_proxy {
 		}
 	}
 
-	void send_message(udp::socket &server_socket, const MsgT &message) {
-		server_socket.send_to(boost::asio::buffer(string(message)), receiver_endpoint);
+	// queue the message, sending the queue at once if it is full;
+	// returns the deadline of the queue if the message started it, not_a_date_time otherwise
+	boost::posix_time::ptime send_message(udp::socket &server_socket, const MsgT &message) {
+		string raw_message(message);
+		boost::mutex::scoped_lock lock(queue_mutex);
+		if (!queue.empty() && queue.size() + raw_message.size() + sizeof(boost::uint32_t) > max_batch_size) {
+			flush_queue(server_socket);
+		}
+		bool started = queue.empty();
+		protocol<>::append_to_batch(queue, raw_message);
+		if (queue.size() >= max_batch_size) {
+			flush_queue(server_socket);
+			return boost::posix_time::ptime();
+		}
+		if (!started) return boost::posix_time::ptime();
+		deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::microseconds(flush_deadline_us);
+		return deadline;
+	}
+	// send all queued messages in one datagram
+	void flush(udp::socket &server_socket) {
+		boost::mutex::scoped_lock lock(queue_mutex);
+		if (!queue.empty()) flush_queue(server_socket);
 	}
+	// send the queue if its deadline is not after time; returns the deadline of a queue started since, if any
+	boost::posix_time::ptime flush_expired(udp::socket &server_socket, const boost::posix_time::ptime &time) {
+		boost::mutex::scoped_lock lock(queue_mutex);
+		if (queue.empty()) return boost::posix_time::ptime();
+		if (deadline > time) return deadline;
+		flush_queue(server_socket);
+		return boost::posix_time::ptime();
+	}
+	const udp::endpoint &get_endpoint() const { return receiver_endpoint; }
  private:
+	static const size_t max_batch_size = 1400; // fits in one Ethernet frame
+	static const long flush_deadline_us = 500; // the longest time a message waits in the queue
+	void flush_queue(udp::socket &server_socket) {
+		server_socket.send_to(boost::asio::buffer(queue), receiver_endpoint);
+		queue.clear();
+	}
 	string hostname;
 	string port;
 	udp::endpoint receiver_endpoint;
 	udp::socket socket;
+	string queue; // batch of messages waiting to be sent
+	boost::posix_time::ptime deadline; // when the queue must be sent at the latest
+	boost::mutex queue_mutex;
 };
 
+template <typename MsgT>
+const long player_proxy<MsgT>::flush_deadline_us;
+
 
 }
 
@@ -11,9 +11,15 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <cmath>
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
 
+#include "acceptor_state.hpp"
 #include "player.hpp"
 #include "protocol.hpp"
+#include "serializer.hpp"
 
 using namespace std;
 
@@ -25,84 +31,184 @@ namespace paxos {
 template <typename ProposalT=string, typename MsgT=typename protocol<ProposalT>::message_type>
 class proposer : virtual public player<MsgT> {
  public:
-	proposer(int id, int port, const vector<pair<string, string> > &peers) :
-		player<MsgT>(id, port, peers), current_number_(protocol<ProposalT>::get_number(id)), peer_counter_(peers.size()) { }
+	proposer(int id, int port, const vector<pair<string, string> > &peers, bool multi_leader = false) :
+		player<MsgT>(id, port, peers), multi_leader_(multi_leader), announced_(false), current_number_(protocol<ProposalT>::get_number(id)), peer_counter_(peers.size()),
+		recovering_(false), recovered_floor_(current_number_) {
+		if (multi_leader_) load_numbers();
+	}
 	virtual ~proposer() { }
  protected:
 	virtual void handle_request(const string &raw_message, boost::shared_ptr<udp::endpoint> remote_endpoint) {
 		MsgT message = MsgT(protocol<ProposalT>::get_message_from_string(raw_message));
 		if (protocol<ProposalT>::is_client_request(message)) {
 			cout << player<MsgT>::get_name() << " receives client_request: " << message << endl;
-			update_mutex_.lock();
+			// acceptors could not save a larger proposal
+			string encoded;
+			serializer<ProposalT>::write(encoded, message.get_proposal());
+			if (encoded.size() > protocol<ProposalT>::max_proposal_size) {
+				cerr << player<MsgT>::get_name() << " rejects client_request with a proposal of " << encoded.size() << " bytes" << endl;
+				return;
+			}
+			if (multi_leader_) {
+				resume();
+				// the number is ours alone, so no other proposal can have been accepted for it: skip phase 1
+				boost::mutex::scoped_lock lock(number_mutex_);
+				int n = get_and_update_current_number();
+				// saved before it is sent, and sent before a later save replaces it, so a restart never reuses n
+				leader_state_->save_accepted(current_number_, n, encoded);
+				typename protocol<ProposalT>::message_type accept_request = protocol<ProposalT>::get_accept_request(n, message.get_proposal());
+				player<MsgT>::send_message_to_all(accept_request);
+				cout << player<MsgT>::get_name() << " sends accept_request to all: " << accept_request << endl;
+				return;
+			}
+			number_mutex_.lock();
 			int n = get_and_update_current_number();
-			accept_counter_[n] = make_pair(0, make_pair(-1, ProposalT()));
-			update_mutex_.unlock();
+			number_mutex_.unlock();
+			bucket &b = get_bucket(n);
+			b.mutex.lock();
+			b.accept_counter[n] = make_pair(0, make_pair(-1, message.get_proposal()));
+			b.mutex.unlock();
 			typename protocol<ProposalT>::message_type prepare_request = protocol<ProposalT>::get_prepare_request(n);
-			send_message_to_all(prepare_request);
+			player<MsgT>::send_message_to_all(prepare_request);
 			cout << player<MsgT>::get_name() << " sends prepare_request to all: " << prepare_request << endl;
 		}
 		else if (protocol<ProposalT>::is_prepare_response(message)) {
 			cout << player<MsgT>::get_name() << " receives prepare_response: " << message << endl;
 			int n = message.get_n();
-			int cnt = -1;
-			update_mutex_.lock();
-			if (accept_counter_.find(n) != accept_counter_.end()) {
-				cnt = ++accept_counter_[n].first;
+			bool reached_majority = false;
+			ProposalT proposal;
+			bucket &b = get_bucket(n);
+			b.mutex.lock();
+			typename accept_counter_type::iterator it = b.accept_counter.find(n);
+			if (it != b.accept_counter.end()) {
+				int cnt = ++it->second.first;
 				int pre_n = message.get_previous_n();
-				if (pre_n != -1) {
-					pair<int, ProposalT> &pp = accept_counter_[n].second;
-					if (pre_n > pp.first) {
-						pp.second = message.get_proposal();
-					}
+				pair<int, ProposalT> &pp = it->second.second;
+				if (pre_n != -1 && pre_n > pp.first) {
+					pp.first = pre_n;
+					pp.second = message.get_proposal();
+				}
+				// test if the number of responses just reaches the majority
+				if (has_just_reached_majority(cnt)) {
+					reached_majority = true;
+					// propose the highest-numbered proposal already accepted, or else the client's one
+					proposal = pp.second;
+					// later responses for n are of no use
+					b.accept_counter.erase(it);
 				}
 			}
-			// test if the number of responses just reaches the majority
-			if (has_just_reached_majority(cnt)) {
-				typename protocol<ProposalT>::message_type accept_request =
-						protocol<ProposalT>::get_accept_request(n,
-								accept_counter_[n].second.first == -1 ? ProposalT(get_proposal(n)) :
-																		accept_counter_[n].second.second);
-				send_message_to_all(accept_request);
+			b.mutex.unlock();
+			if (reached_majority) {
+				typename protocol<ProposalT>::message_type accept_request = protocol<ProposalT>::get_accept_request(n, proposal);
+				player<MsgT>::send_message_to_all(accept_request);
 				cout << player<MsgT>::get_name() << " sends accept_request to all: " << accept_request << endl;
 			}
-			update_mutex_.unlock();
 		}
 		else if (protocol<ProposalT>::is_accept_response(message)) {
 			cout << player<MsgT>::get_name() << " receives accept_response: " << message << endl;
 		}
+		else if (multi_leader_ && protocol<ProposalT>::is_accept_request(message)) {
+			// another leader is using n, so give up our unused numbers below it
+			resume();
+			skip_numbers_below(message.get_n());
+			// the acceptor handles the request itself
+			throw true;
+		}
 		else {
 			// not able to handle the request, pass the information to the higher level
 			throw true;
 		}
 	}
 	virtual string get_player_type() const { return "proposer"; }
+	bool is_multi_leader() const { return multi_leader_; }
  private:
-	// no space should exist in the proposal string
-	string get_proposal(int n) const {
-		ostringstream oss;
-		oss << "Proposal_by_proposer[id=" << player<MsgT>::id_ << "]_for_[n=" << n << "]";
-		return oss.str();
-	}
+	typedef map<int, pair<size_t, pair<int, ProposalT> > > accept_counter_type;
+	// proposals in progress are sharded by number, so that independent proposals do not contend
+	struct bucket {
+		boost::mutex mutex;
+		accept_counter_type accept_counter;
+	};
+	static const size_t bucket_count = 64;
+	bucket &get_bucket(int n) { return buckets_[(static_cast<boost::uint32_t>(n) * 2654435761u >> 16) % bucket_count]; }
 	bool has_just_reached_majority(int cnt) const {
 		return cnt == ceil(peer_counter_ / 2.0);
 	}
 	int get_current_number() const { return current_number_; }
-	boost::mutex update_mutex_;
+	void skip_numbers_below(int n) {
+		if (protocol<ProposalT>::get_owner(n) == player<MsgT>::id_) return;
+		boost::mutex::scoped_lock lock(number_mutex_);
+		int first = current_number_;
+		while (current_number_ < n) get_and_update_current_number();
+		// learners wait for every leader, so announce ourselves once even when there is nothing to skip
+		bool announce = !announced_;
+		announced_ = true;
+		if (first == current_number_ && !announce) return;
+		// the skipped numbers are given up for good, also across a restart
+		if (first != current_number_) leader_state_->save_promise(current_number_);
+		send_skip_request(first, current_number_);
+	}
+	// one message covers the whole range, so an idle leader costs one datagram per round; called with number_mutex_ held
+	void send_skip_request(int first, int next) {
+		typename protocol<ProposalT>::message_type skip_request = protocol<ProposalT>::get_skip_request(first, next);
+		player<MsgT>::send_message_to_all(skip_request);
+		cout << player<MsgT>::get_name() << " sends skip_request to all: " << skip_request << endl;
+		// our own learner, if any, has to know as well; it handles skip_requests without calling back into the proposer
+		try {
+			this->handle_request(string(skip_request), boost::shared_ptr<udp::endpoint>(new udp::endpoint));
+		} catch (bool bit) {
+		}
+	}
+	// multi-leader mode: the state file holds, as promised_n, the number below which every number has been
+	// proposed or skipped, and as the accepted proposal the last one proposed
+	void load_numbers() {
+		leader_state_.reset(new acceptor_state(player<MsgT>::get_id_string() + "_leader.bin"));
+		recovered_proposal_.first = leader_state_->get_accepted_n();
+		if (recovered_proposal_.first != -1) {
+			string encoded = leader_state_->get_accepted_proposal();
+			const char *begin = encoded.data();
+			if (!serializer<ProposalT>::read(begin, begin + encoded.size(), recovered_proposal_.second)) {
+				throw boost::system::system_error(EINVAL, boost::system::system_category(),
+						"proposer: unreadable proposal in state file " + player<MsgT>::get_id_string() + "_leader.bin");
+			}
+		}
+		// the numbers between the last proposal and the promise were skipped at most
+		recovered_floor_ = protocol<ProposalT>::get_number(player<MsgT>::id_, recovered_proposal_.first);
+		if (leader_state_->get_promised_n() > current_number_) current_number_ = leader_state_->get_promised_n();
+		recovering_ = recovered_proposal_.first != -1 || recovered_floor_ != current_number_;
+	}
+	// after a restart, send again what the previous run may not have sent: the last proposal, and the skip of
+	// the numbers after it. The numbers before it are not sent again, their messages went out before it did.
+	void resume() {
+		boost::mutex::scoped_lock lock(number_mutex_);
+		if (!recovering_) return;
+		recovering_ = false;
+		if (recovered_proposal_.first != -1) {
+			typename protocol<ProposalT>::message_type accept_request =
+					protocol<ProposalT>::get_accept_request(recovered_proposal_.first, recovered_proposal_.second);
+			player<MsgT>::send_message_to_all(accept_request);
+			cout << player<MsgT>::get_name() << " sends accept_request to all again: " << accept_request << endl;
+		}
+		if (recovered_floor_ != current_number_) {
+			send_skip_request(recovered_floor_, current_number_);
+			announced_ = true;
+		}
+	}
 	int get_and_update_current_number() {
 		int tmp = current_number_;
 		current_number_ = protocol<ProposalT>::get_number(player<MsgT>::id_, current_number_);
 		return tmp;
 	}
+	bool multi_leader_; // numbers are owned by their proposers and committed without phase 1
+	boost::mutex number_mutex_; // guards the fields below
+	bool announced_; // multi-leader mode: a skip_request has been sent
 	int current_number_; // the current number of the next proposal to be proposed
 	int peer_counter_;
-	map<int, pair<size_t, pair<int, ProposalT> > > accept_counter_;
+	bool recovering_; // multi-leader mode: resume has not run since the restart
+	int recovered_floor_; // the first number after the last proposal before the restart
+	pair<int, ProposalT> recovered_proposal_; // the last proposal before the restart, n = -1 if none
+	boost::scoped_ptr<acceptor_state> leader_state_; // multi-leader mode only
+	bucket buckets_[bucket_count];
 };
 
 
 } // namespace Paxos
-
-
-
-
-
-
@@ -8,8 +8,11 @@
 
 #pragma once
 
+#include <iostream>
 #include <string>
-#include <sstream>
+#include <vector>
+
+#include "serializer.hpp"
 
 using namespace std;
 
@@ -31,40 +34,61 @@ class protocol {
 		int counter = current_number / 10;
 		return ++counter * 10 + id;
 	}
+	// the id of the proposer that the number belongs to, i.e. the inverse of get_number
+	static int get_owner(int n) { return n % 10; }
+	// the largest serialized proposal; acceptors cannot persist a larger one, so players reject it
+	static const size_t max_proposal_size = 1 << 10;
 
 	// unified message type
 	typedef class message {
 		friend class protocol<ProposalT>;
 	 public:
 		operator string() const {
-			ostringstream oss;
-			oss << type_ << " ";
+			string buf(1, static_cast<char>(type_));
 			if (is_client_request()) {
-				oss << message_content_ << " ";
-				return oss.str();
-			}
-			oss << n_ << " ";
-			if (is_prepare_request()) {
-
-			} else if (is_prepare_response()) {
-				oss << previous_n_ << " ";
-				if (previous_n_ != -1) oss << proposal_ << " ";
-			} else if (is_accept_request() || is_accept_response()) {
-				oss << proposal_ << " ";
+				serializer<ProposalT>::write(buf, proposal_);
 			} else {
-				cerr << "Wrong message type in protocol::operator string()" << endl;
+				serializer<int>::write(buf, n_);
+				if (is_prepare_request()) {
+
+				} else if (is_prepare_response()) {
+					serializer<int>::write(buf, previous_n_);
+					if (previous_n_ != -1) serializer<ProposalT>::write(buf, proposal_);
+				} else if (is_accept_request() || is_accept_response()) {
+					serializer<ProposalT>::write(buf, proposal_);
+				} else if (is_skip_request()) {
+					serializer<int>::write(buf, next_n_);
+				} else {
+					cerr << "Wrong message type in protocol::operator string()" << endl;
+				}
 			}
-			oss << message_content_;
-			return oss.str();
+			buf.append(message_content_);
+			return buf;
 		}
 
 		int get_n() const { return n_; }
 		int get_previous_n() const { return previous_n_; }
+		int get_next_n() const { return next_n_; }
 		ProposalT get_proposal() const { return proposal_; }
 		string get_message_content() const { return message_content_; }
 
+		// human-readable form, for logging
 		friend ostream &operator<< (ostream &os, const message &msg) {
-			os << string(msg);
+			os << msg.type_ << " ";
+			if (msg.is_client_request()) {
+				os << msg.proposal_ << " ";
+			} else {
+				os << msg.n_ << " ";
+				if (msg.is_prepare_response()) {
+					os << msg.previous_n_ << " ";
+					if (msg.previous_n_ != -1) os << msg.proposal_ << " ";
+				} else if (msg.is_accept_request() || msg.is_accept_response()) {
+					os << msg.proposal_ << " ";
+				} else if (msg.is_skip_request()) {
+					os << msg.next_n_ << " ";
+				}
+			}
+			os << msg.message_content_;
 			return os;
 		}
 	 private:
@@ -73,9 +97,11 @@ class protocol {
 		bool is_prepare_response() const { return type_ == prepare_response; }
 		bool is_accept_request() const { return type_ == accept_request; }
 		bool is_accept_response() const { return type_ == accept_response; }
-		enum type { client_request, prepare_request, prepare_response, accept_request, accept_response } type_;
+		bool is_skip_request() const { return type_ == skip_request; }
+		enum type { client_request, prepare_request, prepare_response, accept_request, accept_response, skip_request, unknown } type_;
 		int n_;
 	    int previous_n_;
+	    int next_n_; // for skip_request only
 		ProposalT proposal_;
 		string message_content_; // this may not exist at all
 	} message_type;
@@ -83,36 +109,47 @@ class protocol {
 	// creating messages
 	static message_type get_message_from_string(const string &str) {
 		message result;
-		istringstream iss(str);
-		int type;
-		iss >> type;
-		result.type_ = static_cast<typename message::type>(type);
-		if (result.is_client_request()) {
-
+		const char *begin = str.data(), *end = begin + str.size();
+		bool ok = begin != end;
+		if (ok) {
+			unsigned char type = *begin++;
+			result.type_ = type < message::unknown ? static_cast<typename message::type>(type) : message::unknown;
 		}
-		else if (result.is_prepare_request()) {
-			iss >> result.n_;
+		if (!ok) {
+
+		} else if (result.is_client_request()) {
+			ok = serializer<ProposalT>::read(begin, end, result.proposal_);
+		} else if (result.is_prepare_request()) {
+			ok = serializer<int>::read(begin, end, result.n_);
 		} else if (result.is_prepare_response()) {
-			iss >> result.n_;
-			iss >> result.previous_n_;
-			if (result.previous_n_ != -1) iss >> result.proposal_;
+			ok = serializer<int>::read(begin, end, result.n_) &&
+				 serializer<int>::read(begin, end, result.previous_n_) &&
+				 (result.previous_n_ == -1 || serializer<ProposalT>::read(begin, end, result.proposal_));
 		} else if (result.is_accept_request() || result.is_accept_response()) {
-			iss >> result.n_;
-			iss >> result.proposal_;
+			ok = serializer<int>::read(begin, end, result.n_) &&
+				 serializer<ProposalT>::read(begin, end, result.proposal_);
+		} else if (result.is_skip_request()) {
+			ok = serializer<int>::read(begin, end, result.n_) &&
+				 serializer<int>::read(begin, end, result.next_n_);
 		} else {
-			cerr << "Wrong message type in protocol::get_message_from_string(): " << str << endl;
+			ok = false;
 		}
-		getline(iss, result.message_content_);
+		if (!ok) {
+			cerr << "Wrong message in protocol::get_message_from_string() of size " << str.size() << endl;
+			result.type_ = message::unknown;
+			return result;
+		}
+		result.message_content_.assign(begin, end);
 		return result;
 	}
 
-	static message_type get_client_request(const string &content) {
+	static message_type get_client_request(const ProposalT &proposal, const string &content = "") {
 		message result;
 		result.type_ = message::client_request;
+		result.proposal_ = proposal;
 		result.message_content_ = content;
 		return result;
 	}
-
 	static message_type get_prepare_request(int n) {
 		message result;
 		result.type_ = message::prepare_request;
@@ -145,17 +182,55 @@ class protocol {
 		return result;
 	}
 
+	// for multi-leader mode: the sender's numbers from n (inclusive) to next_n (exclusive) stay unused
+	static message_type get_skip_request(int n, int next_n) {
+		message result;
+		result.type_ = message::skip_request;
+		result.n_ = n;
+		result.next_n_ = next_n;
+		return result;
+	}
+
+	// batching messages to the same player into one datagram
+	static void append_to_batch(string &batch, const string &raw_message) {
+		if (batch.empty()) batch.push_back(batch_tag);
+		serializer<string>::write(batch, raw_message);
+	}
+	static vector<string> get_messages_from_batch(const string &datagram) {
+		vector<string> result;
+		if (datagram.empty() || datagram[0] != batch_tag) {
+			// a single message, e.g. from a client
+			result.push_back(datagram);
+			return result;
+		}
+		const char *begin = datagram.data() + 1, *end = datagram.data() + datagram.size();
+		string raw_message;
+		while (begin != end) {
+			if (!serializer<string>::read(begin, end, raw_message)) {
+				cerr << "Truncated batch in protocol::get_messages_from_batch() of size " << datagram.size() << endl;
+				break;
+			}
+			result.push_back(raw_message);
+		}
+		return result;
+	}
+
 	// test message type
 	static bool is_client_request(const message_type &msg) { return msg.is_client_request(); }
 	static bool is_prepare_request(const message_type &msg) { return msg.is_prepare_request(); }
 	static bool is_prepare_response(const message_type &msg) { return msg.is_prepare_response(); }
 	static bool is_accept_request(const message_type &msg) { return msg.is_accept_request(); }
 	static bool is_accept_response(const message_type &msg) { return msg.is_accept_response(); }
+	static bool is_skip_request(const message_type &msg) { return msg.is_skip_request(); }
  private:
+	static const char batch_tag = '\xff'; // never the first byte of a message
 	protocol() { }
 	protocol(const protocol &) {}
 };
 
+template <typename ProposalT>
+const size_t protocol<ProposalT>::max_proposal_size;
+
 
 } // namespace Paxos
 
@@ -0,0 +1,80 @@
+/*
+ * serializer.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *       Email: agent@local
+ */
+
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <boost/cstdint.hpp>
+#include <boost/utility/enable_if.hpp>
+#include <boost/type_traits/is_trivially_copyable.hpp>
+
+using namespace std;
+
+namespace paxos {
+
+/**
+ * Serializer encodes a value at the end of a buffer and decodes it from the front of a range.
+ * The encoding is chosen at compile time from the value type:
+ *   - trivially copyable types are copied byte by byte with a fixed size,
+ *   - std::string is prefixed by its length,
+ *   - any other type goes through operator<< and operator>>, unless the user specializes serializer for it.
+ * Read returns false if the range does not hold a complete value.
+ * Encodings are in host byte order, so all players are expected to run on the same architecture.
+ */
+template <typename T, typename Enable=void>
+struct serializer;
+
+template <typename T>
+struct serializer<T, typename boost::enable_if_c<boost::is_trivially_copyable<T>::value>::type> {
+	static void write(string &buf, const T &value) {
+		buf.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+	static bool read(const char *&begin, const char *end, T &value) {
+		if (static_cast<size_t>(end - begin) < sizeof(T)) return false;
+		memcpy(&value, begin, sizeof(T));
+		begin += sizeof(T);
+		return true;
+	}
+};
+
+template <>
+struct serializer<string> {
+	static void write(string &buf, const string &value) {
+		serializer<boost::uint32_t>::write(buf, value.size());
+		buf.append(value);
+	}
+	static bool read(const char *&begin, const char *end, string &value) {
+		boost::uint32_t size;
+		const char *p = begin;
+		if (!serializer<boost::uint32_t>::read(p, end, size) || static_cast<size_t>(end - p) < size) return false;
+		value.assign(p, size);
+		begin = p + size;
+		return true;
+	}
+};
+
+template <typename T, typename Enable>
+struct serializer {
+	static void write(string &buf, const T &value) {
+		ostringstream oss;
+		oss << value;
+		serializer<string>::write(buf, oss.str());
+	}
+	static bool read(const char *&begin, const char *end, T &value) {
+		string str;
+		if (!serializer<string>::read(begin, end, str)) return false;
+		istringstream iss(str);
+		iss >> value;
+		return !iss.fail();
+	}
+};
+
+
+} // namespace paxos